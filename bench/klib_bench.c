@@ -0,0 +1,498 @@
+#include "klib-arena.h"
+#include "klib-string.h"
+
+#include <time.h>
+
+/*
+ * Benchmark and allocation-profiling suite for KLib.
+ * Results are written to stdout as JSON so runs can be diffed between versions:
+ *
+ *     klib_bench [--min-time seconds] > before.json
+ *
+ * Allocations are counted by linking with --wrap=malloc,calloc,realloc,free (see CMakeLists.txt), which routes
+ * every call made by the headers through the __wrap_* functions below.
+ * The same source is built twice: klib_bench with the default checks, and klib_bench_unchecked with
+ * KLIB_UNCHECKED and NDEBUG, so the cost of the argument checks can be compared directly.
+ */
+
+#ifdef KLIB_UNCHECKED
+#define BENCH_MODE "unchecked"
+#else
+#define BENCH_MODE "checked"
+#endif
+
+// ##########################################################
+//                  Allocation Counting
+// ##########################################################
+
+typedef struct {
+    size_t allocs;
+    size_t reallocs;
+    size_t frees;
+    size_t bytes;
+} AllocStats;
+
+// Not static: calls only reach the wrappers after linking, so the compiler must not assume it sees every writer
+AllocStats alloc_stats;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    alloc_stats.allocs++;
+    alloc_stats.bytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    alloc_stats.allocs++;
+    alloc_stats.bytes += num*size;
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    alloc_stats.reallocs++;
+    alloc_stats.bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    if(ptr != NULL)
+        alloc_stats.frees++;
+    __real_free(ptr);
+}
+
+// ##########################################################
+//                  Measurement
+// ##########################################################
+
+typedef struct {
+    double seconds;
+    AllocStats allocs;
+} Measurement;
+
+static struct timespec bench_start_time;
+static AllocStats bench_start_allocs;
+static Measurement bench_last;
+
+static double bench_min_time = 0.2;
+static int bench_first_result = 1;
+
+static void bench_start() {
+    bench_start_allocs = alloc_stats;
+    clock_gettime(CLOCK_MONOTONIC, &bench_start_time);
+}
+
+static void bench_stop() {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bench_last.seconds = (double)(end.tv_sec - bench_start_time.tv_sec) + (double)(end.tv_nsec - bench_start_time.tv_nsec)*1e-9;
+    bench_last.allocs.allocs = alloc_stats.allocs - bench_start_allocs.allocs;
+    bench_last.allocs.reallocs = alloc_stats.reallocs - bench_start_allocs.reallocs;
+    bench_last.allocs.frees = alloc_stats.frees - bench_start_allocs.frees;
+    bench_last.allocs.bytes = alloc_stats.bytes - bench_start_allocs.bytes;
+}
+
+/*
+ * A benchmark does its setup, calls bench_start, runs iterations operations, calls bench_stop and cleans up.
+ * It returns the number of input bytes processed by one operation, used for the bytes/s figure
+ */
+typedef size_t (*BenchFunction)(size_t size, size_t iterations);
+
+/*
+ * Runs fn with a doubling iteration count until one run takes at least bench_min_time, then prints that run
+ */
+static void run_bench(const char* name, BenchFunction fn, size_t size) {
+    size_t iterations = 1;
+    size_t bytes;
+    for(;;) {
+        bytes = fn(size, iterations);
+        if(bench_last.seconds >= bench_min_time || iterations >= ((size_t)1 << 40))
+            break;
+        iterations *= 2;
+    }
+    double ops = (double)iterations;
+    printf("%s\n    {\"name\": \"%s\", \"size\": %zu, \"iterations\": %zu, \"ns_per_op\": %.2f, \"bytes_per_second\": %.0f, "
+           "\"allocs_per_op\": %.3f, \"reallocs_per_op\": %.3f, \"frees_per_op\": %.3f, \"alloc_bytes_per_op\": %.1f}",
+           bench_first_result ? "" : ",", name, size, iterations,
+           bench_last.seconds*1e9/ops,
+           bench_last.seconds > 0 ? (double)bytes*ops/bench_last.seconds : 0.0,
+           (double)bench_last.allocs.allocs/ops, (double)bench_last.allocs.reallocs/ops,
+           (double)bench_last.allocs.frees/ops, (double)bench_last.allocs.bytes/ops);
+    bench_first_result = 0;
+    fflush(stdout);
+}
+
+// ##########################################################
+//                  Input Generation
+// ##########################################################
+
+static unsigned int bench_seed = 12345;
+
+static unsigned int bench_rand() {
+    bench_seed = bench_seed*1103515245u + 12345u;
+    return (bench_seed >> 16) & 0x7fff;
+}
+
+/*
+ * Fills a NUL terminated buffer of size chars with words of 1-10 mixed-case letters separated by spaces
+ */
+static char* make_text(size_t size) {
+    char* text = (char*)malloc(size+1);
+    size_t i = 0;
+    while(i < size) {
+        size_t word = 1 + bench_rand()%10;
+        for(size_t j=0; j<word && i<size; j++, i++)
+            text[i] = (char)((bench_rand()%2 ? 'a' : 'A') + bench_rand()%26);
+        if(i < size)
+            text[i++] = ' ';
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// ##########################################################
+//                  Benchmarks
+// ##########################################################
+
+static volatile size_t bench_sink;
+
+#define BENCH_ARENA_CHUNKS 4
+
+/*
+ * The number of size-byte objects that fill BENCH_ARENA_CHUNKS chunks, including the alignment padding
+ */
+static size_t arena_objects(size_t size) {
+    size_t aligned = (size + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+    return BENCH_ARENA_CHUNKS * (DEFAULT_CHUNK_SIZE / aligned);
+}
+
+/*
+ * Allocations fill BENCH_ARENA_CHUNKS chunks before each reset, so they cross chunk boundaries. 
+ * The first pass maps the chunks and later passes reuse the chunks kept by arena_reset
+ */
+static size_t bench_arena_alloc(size_t size, size_t iterations) {
+    Arena* arena = new_arena();
+    size_t perReset = arena_objects(size);
+    size_t used = 0;
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        if(used == perReset) {
+            arena_reset(arena);
+            used = 0;
+        }
+        bench_sink += (size_t)arena_alloc(arena, size);
+        used++;
+    }
+    bench_stop();
+    arena_free(arena);
+    return size;
+}
+
+static size_t bench_arena_reset(size_t size, size_t iterations) {
+    Arena* arena = new_arena();
+    size_t perReset = arena_objects(size);
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        for(size_t j=0; j<perReset; j++)
+            bench_sink += (size_t)arena_alloc(arena, size);
+        arena_reset(arena);
+    }
+    bench_stop();
+    arena_free(arena);
+    return perReset*size;
+}
+
+static size_t bench_new_string_append_c(size_t size, size_t iterations) {
+    char piece[17];
+    memset(piece, 'x', 16);
+    piece[16] = '\0';
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        String* str = new_string();
+        for(size_t appended=0; appended<size; appended+=16)
+            string_append_c(str, piece);
+        bench_sink += str->size;
+        free_string(str);
+    }
+    bench_stop();
+    return size;
+}
+
+static size_t bench_tokenize_c(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* str = new_set_string(text);
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        unsigned int count;
+        String** tokens = tokenize_c(str, " ", &count);
+        for(unsigned int t=0; t<count; t++)
+            free_string(tokens[t]);
+        free(tokens);
+        bench_sink += count;
+    }
+    bench_stop();
+    free_string(str);
+    free(text);
+    return size;
+}
+
+static size_t bench_find_substring_c(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* str = new_set_string(text);
+    char needle[] = "needle";
+    // place the only match at the end, so every search scans the whole String
+    if(size >= sizeof(needle))
+        memcpy(str->buffer + size - (sizeof(needle)-1), needle, sizeof(needle)-1);
+    bench_start();
+    for(size_t i=0; i<iterations; i++)
+        bench_sink += find_substring_c(str, needle);
+    bench_stop();
+    free_string(str);
+    free(text);
+    return size;
+}
+
+static size_t bench_find_substring_ci_c(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* str = new_set_string(text);
+    char needle[] = "needle";
+    if(size >= sizeof(needle))
+        memcpy(str->buffer + size - (sizeof(needle)-1), needle, sizeof(needle)-1);
+    bench_start();
+    for(size_t i=0; i<iterations; i++)
+        bench_sink += find_substring_ci_c(str, "NeEdLe");
+    bench_stop();
+    free_string(str);
+    free(text);
+    return size;
+}
+
+static size_t bench_to_lowercase(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* str = new_set_string(text);
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        to_lowercase(str);
+        bench_sink += (size_t)str->buffer[0];
+    }
+    bench_stop();
+    free_string(str);
+    free(text);
+    return size;
+}
+
+/*
+ * Each operation re-sets the padded input before stripping it, so the time includes one string_set
+ */
+static size_t bench_strip(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    size_t pad = size/4;
+    for(size_t i=0; i<pad; i++) {
+        text[i] = ' ';
+        text[size-1-i] = '\t';
+    }
+    String* str = new_string();
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        string_set(str, text);
+        strip(str);
+        bench_sink += str->size;
+    }
+    bench_stop();
+    free_string(str);
+    free(text);
+    return size;
+}
+
+/*
+ * Each operation empties dest and appends the encoding of size bytes, so after the first iteration dest is never resized
+ */
+static size_t bench_string_append_hex(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* src = new_set_string(text);
+    String* dest = new_string();
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        dest->size = 0;
+        string_append_hex(dest, src);
+        bench_sink += dest->size;
+    }
+    bench_stop();
+    free_string(src);
+    free_string(dest);
+    free(text);
+    return size;
+}
+
+static size_t bench_string_append_base64(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* src = new_set_string(text);
+    String* dest = new_string();
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        dest->size = 0;
+        string_append_base64(dest, src);
+        bench_sink += dest->size;
+    }
+    bench_stop();
+    free_string(src);
+    free_string(dest);
+    free(text);
+    return size;
+}
+
+static size_t bench_string_append_from_base64(size_t size, size_t iterations) {
+    char* text = make_text(size);
+    String* raw = new_set_string(text);
+    String* src = new_string();
+    string_append_base64(src, raw);
+    String* dest = new_string();
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        dest->size = 0;
+        bench_sink += string_append_from_base64(dest, src);
+    }
+    bench_stop();
+    free_string(raw);
+    free_string(src);
+    free_string(dest);
+    free(text);
+    return size;
+}
+
+/*
+ * Compares two independent texts of size chars, so the distance is large and the early exit never triggers
+ */
+static size_t bench_string_edit_distance(size_t size, size_t iterations) {
+    char* text1 = make_text(size);
+    char* text2 = make_text(size);
+    String* str1 = new_set_string(text1);
+    String* str2 = new_set_string(text2);
+    bench_start();
+    for(size_t i=0; i<iterations; i++)
+        bench_sink += string_edit_distance(str1, str2, (size_t)-1);
+    bench_stop();
+    free_string(str1);
+    free_string(str2);
+    free(text1);
+    free(text2);
+    return size;
+}
+
+static String** make_tokens(size_t count) {
+    String** tokens = (String**)malloc(count*sizeof(String*));
+    char word[16];
+    for(size_t i=0; i<count; i++) {
+        size_t len = 3 + bench_rand()%10;
+        for(size_t j=0; j<len; j++)
+            word[j] = (char)('a' + bench_rand()%26);
+        word[len] = '\0';
+        tokens[i] = new_set_string(word);
+    }
+    return tokens;
+}
+
+static void free_tokens(String** tokens, size_t count) {
+    for(size_t i=0; i<count; i++)
+        free_string(tokens[i]);
+    free(tokens);
+}
+
+static int compare_string_pointers(const void* a, const void* b) {
+    return string_compare(*(String**)a, *(String**)b);
+}
+
+/*
+ * The sorting benchmarks restore the unsorted order before each sort, so the time includes one memcpy of count pointers
+ */
+static size_t bench_qsort_string_compare(size_t count, size_t iterations) {
+    String** tokens = make_tokens(count);
+    String** work = (String**)malloc(count*sizeof(String*));
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        memcpy(work, tokens, count*sizeof(String*));
+        qsort(work, count, sizeof(String*), compare_string_pointers);
+    }
+    bench_stop();
+    free(work);
+    free_tokens(tokens, count);
+    return count*sizeof(String*);
+}
+
+static size_t bench_string_sort(size_t count, size_t iterations) {
+    String** tokens = make_tokens(count);
+    String** work = (String**)malloc(count*sizeof(String*));
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        memcpy(work, tokens, count*sizeof(String*));
+        string_sort(work, (unsigned int)count);
+    }
+    bench_stop();
+    free(work);
+    free_tokens(tokens, count);
+    return count*sizeof(String*);
+}
+
+static size_t bench_string_sort_parallel(size_t count, size_t iterations) {
+    String** tokens = make_tokens(count);
+    String** work = (String**)malloc(count*sizeof(String*));
+    bench_start();
+    for(size_t i=0; i<iterations; i++) {
+        memcpy(work, tokens, count*sizeof(String*));
+        string_sort_parallel(work, (unsigned int)count, 0);
+    }
+    bench_stop();
+    free(work);
+    free_tokens(tokens, count);
+    return count*sizeof(String*);
+}
+
+// ##########################################################
+//                  Main
+// ##########################################################
+
+int main(int argc, char** argv) {
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--min-time") == 0 && i+1 < argc) {
+            bench_min_time = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "usage: %s [--min-time seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const size_t objectSizes[] = {16, 64, 256};
+    const size_t stringSizes[] = {16, 256, 4096, 65536};
+    const size_t sortSizes[] = {1000, 100000, 1000000};
+
+    printf("{\n  \"library\": \"klib\",\n  \"mode\": \"%s\",\n  \"benchmarks\": [", BENCH_MODE);
+    for(size_t i=0; i<sizeof(objectSizes)/sizeof(objectSizes[0]); i++) {
+        run_bench("arena_alloc", bench_arena_alloc, objectSizes[i]);
+        run_bench("arena_reset", bench_arena_reset, objectSizes[i]);
+    }
+    for(size_t i=0; i<sizeof(stringSizes)/sizeof(stringSizes[0]); i++) {
+        run_bench("new_string_append_c", bench_new_string_append_c, stringSizes[i]);
+        run_bench("tokenize_c", bench_tokenize_c, stringSizes[i]);
+        run_bench("find_substring_c", bench_find_substring_c, stringSizes[i]);
+        run_bench("find_substring_ci_c", bench_find_substring_ci_c, stringSizes[i]);
+        run_bench("to_lowercase", bench_to_lowercase, stringSizes[i]);
+        run_bench("strip", bench_strip, stringSizes[i]);
+        run_bench("string_append_hex", bench_string_append_hex, stringSizes[i]);
+        run_bench("string_append_base64", bench_string_append_base64, stringSizes[i]);
+        run_bench("string_append_from_base64", bench_string_append_from_base64, stringSizes[i]);
+        // quadratic, so the largest input would dominate the run time
+        if(stringSizes[i] <= 4096)
+            run_bench("string_edit_distance", bench_string_edit_distance, stringSizes[i]);
+    }
+    for(size_t i=0; i<sizeof(sortSizes)/sizeof(sortSizes[0]); i++) {
+        run_bench("qsort_string_compare", bench_qsort_string_compare, sortSizes[i]);
+        run_bench("string_sort", bench_string_sort, sortSizes[i]);
+        run_bench("string_sort_parallel", bench_string_sort_parallel, sortSizes[i]);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -20,6 +20,7 @@ typedef struct ArenaChunk{
 
 typedef struct {
     ArenaChunk* head;
+    ArenaChunk* current;
     size_t elems;
 } Arena;
 
@@ -71,6 +72,7 @@ Arena* new_arena() {
     arena->elems = 0;
 
     arena->head = new_chunk();
+    arena->current = arena->head;
 
     return arena;
 }
@@ -86,43 +88,39 @@ void* arena_alloc(Arena* arena, size_t size) {
         return NULL;
     }
 
-    ArenaChunk* crr = arena->head;
+    ArenaChunk* crr = arena->current;
 
     uintptr_t current = (uintptr_t)(crr->buffer + crr->offset);
     uintptr_t aligned = (current + alignof(max_align_t) - 1) & ~(uintptr_t)(alignof(max_align_t) - 1);
     size_t padding = aligned - current;
-    crr->offset += padding;
 
-    if(crr->offset + size >= DEFAULT_CHUNK_SIZE) {
-        if(crr->next != NULL) {
-            crr = crr->next;
-        }
-        else {
+    // Move on to the next chunk, reusing the chunks kept by arena_reset before mapping a new one. 
+    // Chunk buffers are page aligned, so an object at the start of a chunk needs no padding
+    if(crr->offset + padding + size > DEFAULT_CHUNK_SIZE) {
+        if(crr->next == NULL)
             crr->next = new_chunk();
-            crr = crr->next;
-        }
-        return crr->buffer;
+        crr = crr->next;
+        arena->current = crr;
+        padding = 0;
     }
 
-    
-    void* dest = crr->buffer + crr->offset;
-    crr->offset += size;
+    void* dest = crr->buffer + crr->offset + padding;
+    crr->offset += padding + size;
 
     arena->elems += 1;
     return dest;
 }
 
 /*
- * @brief    Resets the arena
+ * @brief    Resets the arena. Its chunks are kept and reused by later allocations
  * @param    arena - the arena being reset
  * @returns  none
  */
 void arena_reset(Arena* arena) {
     arena->elems = 0;
+    arena->current = arena->head;
     ArenaChunk *current = arena->head;
-    current->offset = 0;
-    current = current->next;
-    while(current->next != NULL) {
+    while(current != NULL) {
         current->offset = 0;
         current = current->next;
     }
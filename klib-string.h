@@ -3,6 +3,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#ifdef KLIB_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+/*
+ * Build-time modes:
+ *   KLIB_UNCHECKED - argument checks become debug asserts (compiled out with NDEBUG), so hot loops carry no
+ *                    NULL/bounds tests and no calls to print_error
+ *   KLIB_NO_EXIT   - a failed check records the error and makes the function return early instead of exiting.
+ *                    The error can be queried with string_last_error() and cleared with string_clear_error()
+ *   KLIB_COW       - buffers are reference counted and shared between copies, so new_copy_string and string_copy
+ *                    are O(1). Every mutator detaches the buffer first if it is shared. The refcount is atomic, so
+ *                    Strings sharing a buffer can be used from different threads (a single String still cannot).
+ *                    Call string_detach before writing through the pointer returned by c_string
+ *   KLIB_FOLD_UTF8 - the case-insensitive functions (*_ci) decode UTF-8 and apply simple case folding to Latin-1,
+ *                    Latin Extended-A, Greek and Cyrillic, instead of folding ASCII letters only. Every mapping
+ *                    keeps the encoded length, so Strings of different sizes are never equal in either mode
+ *   KLIB_THREADS   - string_sort_parallel and string_edit_distance_batch spread their work over POSIX threads. 
+ *                    Without it they run on the calling thread, and the header needs neither pthreads nor unistd.h
+ *
+ * Vector kernels (SSE2, SSSE3, AVX2) are selected at compile time from the target flags, e.g. -mavx2 or
+ * -march=native, and every function has a scalar fallback
+ */
+#if defined(KLIB_UNCHECKED) && defined(NDEBUG)
+#define KLIB_CHECK(cond, func, msg, ret) ((void)sizeof(cond))
+#define KLIB_CHECK_VOID(cond, func, msg) ((void)sizeof(cond))
+#elif defined(KLIB_UNCHECKED)
+#define KLIB_CHECK(cond, func, msg, ret) assert(!(cond) && msg)
+#define KLIB_CHECK_VOID(cond, func, msg) assert(!(cond) && msg)
+#else
+#define KLIB_CHECK(cond, func, msg, ret) do { if(cond) { print_error(func, msg); return ret; } } while(0)
+#define KLIB_CHECK_VOID(cond, func, msg) do { if(cond) { print_error(func, msg); return; } } while(0)
+#endif
 
 typedef struct {
     char* buffer;
@@ -12,6 +56,8 @@ typedef struct {
 
 void dump_string(String* str);
 void print_error(const char* func, const char* msg);
+const char* string_last_error();
+void string_clear_error();
 String* new_string();
 void free_string(String* str);
 size_t string_size(String* str);
@@ -44,7 +90,59 @@ String** tokenize(String* str, String* delimiters, unsigned int* c);
 size_t find_substring_c(String* str1, char* str2);
 size_t find_substring(String* str1, String* str2);
 String* get_substring(String* str, size_t location, size_t length);
+String* string_join_c(String** strs, unsigned int count, char* sep);
+String* string_join(String** strs, unsigned int count, String* sep);
+String* string_replace_c(String* str, char* needle, char* repl);
+String* string_replace(String* str, String* needle, String* repl);
+String* string_replace_all_c(String* str, char* needle, char* repl);
+String* string_replace_all(String* str, String* needle, String* repl);
+void string_reserve(String* str, size_t bufferSize);
+void string_detach(String* str);
+void string_sort(String** strs, unsigned int count);
+void string_sort_parallel(String** strs, unsigned int count, unsigned int threads);
+unsigned int string_dedup(String** strs, unsigned int count);
+size_t string_edit_distance(String* str1, String* str2, size_t max);
+int string_compare_ci_c(String* str1, char* str2);
+int string_compare_ci(String* str1, String* str2);
+int string_equal_ci_c(String* str1, char* str2);
+int string_equal_ci(String* str1, String* str2);
+size_t find_substring_ci_c(String* str1, char* str2);
+size_t find_substring_ci(String* str1, String* str2);
+void string_append_hex(String* dest, String* src);
+int string_append_from_hex(String* dest, String* src);
+void string_append_base64(String* dest, String* src);
+int string_append_from_base64(String* dest, String* src);
+unsigned int string_edit_distance_batch(String* query, String** strs, unsigned int count, size_t max, size_t* distances, unsigned int threads);
+
+// ##########################################################
+//                  Unchecked Accessors
+// ##########################################################
+
+/*
+ * Variants of the accessors that skip the NULL and bounds checks. 
+ * The preconditions are only verified by assert, so they are free in release builds and can be used inside loops. 
+ * In KLIB_COW mode set_index_unchecked does not detach the buffer, so call string_detach once before the loop
+ */
+
+static inline size_t string_size_unchecked(String* str) {
+    assert(str != NULL);
+    return str->size;
+}
+
+static inline char* c_string_unchecked(String* str) {
+    assert(str != NULL);
+    return str->buffer;
+}
 
+static inline char get_index_unchecked(String* str, size_t index) {
+    assert(str != NULL && index < str->size);
+    return str->buffer[index];
+}
+
+static inline void set_index_unchecked(String* str, size_t index, char c) {
+    assert(str != NULL && index < str->size);
+    str->buffer[index] = c;
+}
 
 // ##########################################################
 //                  Internal Use Functions
@@ -58,9 +156,894 @@ void dump_string(String* str) {
     printf("string size: %lu\n", str->size);
 };
 
+#ifdef KLIB_COW
+typedef struct {
+    size_t refs;
+} StringBufferHeader;
+
+#define STRING_BUFFER_HEADER(buffer) ((StringBufferHeader*)((buffer) - sizeof(StringBufferHeader)))
+#endif
+
+/*
+ * Allocates a buffer of bufferSize chars. In KLIB_COW mode the buffer is preceded by its refcount
+ */
+static char* string_buffer_alloc(size_t bufferSize) {
+#ifdef KLIB_COW
+    StringBufferHeader* header = (StringBufferHeader*)malloc(sizeof(StringBufferHeader) + bufferSize);
+    header->refs = 1;
+    return (char*)(header + 1);
+#else
+    return (char*)malloc(bufferSize);
+#endif
+};
+
+/*
+ * Resizes a buffer that is not shared with any other String
+ */
+static char* string_buffer_realloc(char* buffer, size_t bufferSize) {
+#ifdef KLIB_COW
+    StringBufferHeader* header = (StringBufferHeader*)realloc(STRING_BUFFER_HEADER(buffer), sizeof(StringBufferHeader) + bufferSize);
+    return (char*)(header + 1);
+#else
+    return (char*)realloc(buffer, bufferSize);
+#endif
+};
+
+/*
+ * Drops a reference to a buffer, freeing it once no String uses it
+ */
+static void string_buffer_release(char* buffer) {
+#ifdef KLIB_COW
+    StringBufferHeader* header = STRING_BUFFER_HEADER(buffer);
+    if(__atomic_fetch_sub(&header->refs, 1, __ATOMIC_ACQ_REL) == 1)
+        free(header);
+#else
+    free(buffer);
+#endif
+};
+
+/*
+ * Makes sure str owns its buffer and that the buffer can hold bufferSize chars. 
+ * A shared buffer is copied once, directly at the new capacity, instead of being detached and then grown
+ */
+void string_reserve(String* str, size_t bufferSize) {
+#ifdef KLIB_COW
+    if(__atomic_load_n(&STRING_BUFFER_HEADER(str->buffer)->refs, __ATOMIC_ACQUIRE) > 1) {
+        if(bufferSize < str->bufferSize)
+            bufferSize = str->bufferSize;
+        char* buffer = string_buffer_alloc(bufferSize);
+        memcpy(buffer, str->buffer, str->size+1);
+        string_buffer_release(str->buffer);
+        str->buffer = buffer;
+        str->bufferSize = bufferSize;
+        return;
+    }
+#endif
+    if(bufferSize > str->bufferSize) {
+        str->bufferSize = bufferSize;
+        str->buffer = string_buffer_realloc(str->buffer, str->bufferSize);
+    }
+};
+
+/*
+ * Resolves a requested thread count: 0 selects one thread per online processor. Always 1 without KLIB_THREADS
+ */
+static unsigned int resolve_threads(unsigned int threads) {
+#ifdef KLIB_THREADS
+    if(threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned int)online : 1;
+    }
+    return threads;
+#else
+    (void)threads;
+    return 1;
+#endif
+};
+
+/*
+ * Runs worker on threads-1 new threads and on the calling thread, and waits for all of them to return. 
+ * If a thread cannot be created the remaining work is shared by the threads already running
+ */
+static void run_workers(void* (*worker)(void*), void* job, unsigned int threads) {
+#ifdef KLIB_THREADS
+    pthread_t* workers = (pthread_t*)malloc((threads-1)*sizeof(pthread_t));
+    unsigned int started = 0;
+    for(; started<threads-1; started++) {
+        if(pthread_create(&workers[started], NULL, worker, job) != 0)
+            break;
+    }
+    worker(job);
+    for(unsigned int i=0; i<started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+#else
+    (void)threads;
+    worker(job);
+#endif
+};
+
+#define STRING_SORT_CUTOFF 32
+#define STRING_SORT_PARALLEL_MIN 65536
+
+/*
+ * Compares the suffixes of str1 and str2 starting at depth, using the stored sizes
+ */
+static int compare_from(String* str1, String* str2, size_t depth) {
+    size_t l1 = str1->size - depth;
+    size_t l2 = str2->size - depth;
+    int r = memcmp(str1->buffer + depth, str2->buffer + depth, l1 < l2 ? l1 : l2);
+    if(r != 0)
+        return r;
+    return (l1 > l2) - (l1 < l2);
+};
+
+/*
+ * Sorts small ranges in which every String shares its first depth characters
+ */
+static void insertion_sort_from(String** strs, size_t n, size_t depth) {
+    for(size_t i=1; i<n; i++) {
+        String* cur = strs[i];
+        size_t j = i;
+        while(j > 0 && compare_from(strs[j-1], cur, depth) > 0) {
+            strs[j] = strs[j-1];
+            --j;
+        }
+        strs[j] = cur;
+    }
+};
+
+/*
+ * Distributes strs into 257 buckets by the character at depth. Bucket 0 holds the Strings that end at depth. 
+ * The characters are read once into keys, so the String buffers are only touched by the counting pass. 
+ * On return, bucket b occupies strs[starts[b], starts[b+1])
+ */
+static void radix_partition(String** strs, String** temp, uint16_t* keys, size_t n, size_t depth, size_t* starts) {
+    size_t counts[257] = {0};
+    for(size_t i=0; i<n; i++) {
+        String* str = strs[i];
+        keys[i] = depth < str->size ? (uint16_t)((unsigned char)str->buffer[depth] + 1) : 0;
+        counts[keys[i]]++;
+    }
+    size_t offsets[257];
+    size_t sum = 0;
+    for(int b=0; b<257; b++) {
+        starts[b] = sum;
+        offsets[b] = sum;
+        sum += counts[b];
+    }
+    starts[257] = sum;
+    for(size_t i=0; i<n; i++)
+        temp[offsets[keys[i]]++] = strs[i];
+    memcpy(strs, temp, n*sizeof(String*));
+};
+
+/*
+ * MSD radix sort of a range in which every String shares its first depth characters. 
+ * The largest bucket is handled by the loop rather than by recursion, so the stack depth stays O(log n) 
+ * even for long common prefixes
+ */
+static void radix_sort_from(String** strs, String** temp, uint16_t* keys, size_t n, size_t depth) {
+    size_t starts[258];
+    while(n >= STRING_SORT_CUTOFF) {
+        radix_partition(strs, temp, keys, n, depth, starts);
+        int largest = 1;
+        for(int b=2; b<257; b++) {
+            if(starts[b+1]-starts[b] > starts[largest+1]-starts[largest])
+                largest = b;
+        }
+        for(int b=1; b<257; b++) {
+            size_t size = starts[b+1]-starts[b];
+            if(b != largest && size > 1)
+                radix_sort_from(strs + starts[b], temp + starts[b], keys + starts[b], size, depth+1);
+        }
+        strs += starts[largest];
+        temp += starts[largest];
+        keys += starts[largest];
+        n = starts[largest+1]-starts[largest];
+        depth += 1;
+    }
+    insertion_sort_from(strs, n, depth);
+};
+
+typedef struct {
+    size_t offset;
+    size_t n;
+    size_t depth;
+} StringSortTask;
+
+typedef struct {
+    String** strs;
+    String** temp;
+    uint16_t* keys;
+    StringSortTask* tasks;
+    size_t taskCount;
+    size_t next;
+} StringSortJob;
+
+static void* radix_sort_worker(void* arg) {
+    StringSortJob* job = (StringSortJob*)arg;
+    size_t t;
+    while((t = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->taskCount) {
+        StringSortTask* task = &job->tasks[t];
+        radix_sort_from(job->strs + task->offset, job->temp + task->offset, job->keys + task->offset, task->n, task->depth);
+    }
+    return NULL;
+};
+
+/*
+ * Builds the match vectors for pattern, one 64-bit word per 64 pattern characters for each of the 256 byte values. 
+ * Bit i of the vectors for character c is set if pattern[i] == c. The vectors of one character are contiguous
+ */
+static uint64_t* edit_pattern(const char* pattern, size_t m) {
+    size_t blocks = (m + 63) / 64;
+    uint64_t* peq = (uint64_t*)calloc(256*blocks, sizeof(uint64_t));
+    for(size_t i=0; i<m; i++)
+        peq[(unsigned char)pattern[i]*blocks + i/64] |= (uint64_t)1 << (i%64);
+    return peq;
+};
+
+/*
+ * Advances one 64-row block of the edit distance matrix by one text character (Myers' algorithm as extended by Hyyro). 
+ * pv and mv hold the positive and negative vertical deltas of the block, hin is the horizontal delta entering the top 
+ * of the block, and the horizontal delta leaving the row selected by high is returned
+ */
+static int edit_advance_block(uint64_t* pv, uint64_t* mv, uint64_t eq, int hin, uint64_t high) {
+    uint64_t Pv = *pv;
+    uint64_t Mv = *mv;
+    uint64_t Xv = eq | Mv;
+    if(hin < 0)
+        eq |= 1;
+    uint64_t Xh = (((eq & Pv) + Pv) ^ Pv) | eq;
+    uint64_t Ph = Mv | ~(Xh | Pv);
+    uint64_t Mh = Pv & Xh;
+
+    int hout = 0;
+    if(Ph & high)
+        hout = 1;
+    else if(Mh & high)
+        hout = -1;
+
+    Ph <<= 1;
+    Mh <<= 1;
+    if(hin < 0)
+        Mh |= 1;
+    else if(hin > 0)
+        Ph |= 1;
+
+    *pv = Mh | ~(Xv | Ph);
+    *mv = Ph & Xv;
+    return hout;
+};
+
+/*
+ * Computes the Levenshtein distance between the pattern described by peq (of length m) and text. 
+ * Only the last row of the matrix is tracked. Since each remaining text character can lower it by at most one, 
+ * the computation stops as soon as the distance cannot come back down to max, and max+1 is returned
+ */
+static size_t edit_distance_bitparallel(const uint64_t* peq, size_t m, const char* text, size_t n, size_t max) {
+    size_t lower = m > n ? m-n : n-m;
+    if(lower > max)
+        return max+1;
+    if(m == 0)
+        return n;
+
+    size_t blocks = (m + 63) / 64;
+    uint64_t last = (uint64_t)1 << ((m-1) % 64);
+    size_t score = m;
+
+    if(blocks == 1) {
+        uint64_t Pv = ~(uint64_t)0;
+        uint64_t Mv = 0;
+        for(size_t j=0; j<n; j++) {
+            score += edit_advance_block(&Pv, &Mv, peq[(unsigned char)text[j]], 1, last);
+            if(score > n-j-1 && score-(n-j-1) > max)
+                return max+1;
+        }
+        return score;
+    }
+
+    uint64_t* P = (uint64_t*)malloc(2*blocks*sizeof(uint64_t));
+    uint64_t* M = P + blocks;
+    for(size_t b=0; b<blocks; b++) {
+        P[b] = ~(uint64_t)0;
+        M[b] = 0;
+    }
+    uint64_t high = (uint64_t)1 << 63;
+    for(size_t j=0; j<n; j++) {
+        const uint64_t* eq = peq + (unsigned char)text[j]*blocks;
+        int h = 1;
+        for(size_t b=0; b<blocks-1; b++)
+            h = edit_advance_block(&P[b], &M[b], eq[b], h, high);
+        score += edit_advance_block(&P[blocks-1], &M[blocks-1], eq[blocks-1], h, last);
+        if(score > n-j-1 && score-(n-j-1) > max) {
+            score = max+1;
+            break;
+        }
+    }
+    free(P);
+    return score;
+};
+
+typedef struct {
+    const uint64_t* peq;
+    size_t m;
+    String** strs;
+    unsigned int count;
+    size_t max;
+    size_t* distances;
+    unsigned int next;
+} EditDistanceJob;
+
+#define EDIT_DISTANCE_BATCH_CHUNK 64
+
+static void* edit_distance_worker(void* arg) {
+    EditDistanceJob* job = (EditDistanceJob*)arg;
+    unsigned int start;
+    while((start = __atomic_fetch_add(&job->next, EDIT_DISTANCE_BATCH_CHUNK, __ATOMIC_RELAXED)) < job->count) {
+        unsigned int end = job->count - start < EDIT_DISTANCE_BATCH_CHUNK ? job->count : start + EDIT_DISTANCE_BATCH_CHUNK;
+        for(unsigned int i=start; i<end; i++)
+            job->distances[i] = edit_distance_bitparallel(job->peq, job->m, job->strs[i]->buffer, job->strs[i]->size, job->max);
+    }
+    return NULL;
+};
+
+static unsigned char fold_ascii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c+32 : c;
+};
+
+#ifdef KLIB_FOLD_UTF8
+/*
+ * Simple case folding for the two-byte UTF-8 range. Only mappings whose source and target both encode in two bytes
+ * are applied, so folding never changes the length of a String
+ */
+static uint32_t fold_codepoint(uint32_t cp) {
+    if(cp < 0x80)
+        return fold_ascii((unsigned char)cp);
+    if(cp == 0xB5)
+        return 0x3BC;
+    if(cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)
+        return cp + 0x20;
+    if(cp >= 0x100 && cp <= 0x17F) {
+        if(cp == 0x178)
+            return 0xFF;
+        if((cp <= 0x12F || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) && cp % 2 == 0)
+            return cp + 1;
+        if(((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) && cp % 2 == 1)
+            return cp + 1;
+        return cp;
+    }
+    if(cp >= 0x386 && cp <= 0x3AB) {
+        if(cp == 0x386)
+            return 0x3AC;
+        if(cp >= 0x388 && cp <= 0x38A)
+            return cp + 0x25;
+        if(cp == 0x38C)
+            return 0x3CC;
+        if(cp == 0x38E || cp == 0x38F)
+            return cp + 0x3F;
+        if(cp >= 0x391 && cp != 0x3A2)
+            return cp + 0x20;
+        return cp;
+    }
+    if(cp == 0x3C2)
+        return 0x3C3;
+    if(cp >= 0x400 && cp <= 0x40F)
+        return cp + 0x50;
+    if(cp >= 0x410 && cp <= 0x42F)
+        return cp + 0x20;
+    if(cp >= 0x460 && cp <= 0x481 && cp % 2 == 0)
+        return cp + 1;
+    return cp;
+};
+
+/*
+ * Decodes the UTF-8 sequence at s (n bytes available) and returns its folded code point, storing its length in len. 
+ * A malformed byte is returned on its own, offset past the code point range so it only ever matches itself. 
+ * Overlong forms, surrogates and code points above 0x10FFFF are malformed, so each code point has a single encoding 
+ * and only sequences of the same length can fold to the same value
+ */
+static uint32_t fold_utf8_next(const char* s, size_t n, size_t* len) {
+    const unsigned char* u = (const unsigned char*)s;
+    if(u[0] < 0x80) {
+        *len = 1;
+        return fold_ascii(u[0]);
+    }
+    if(u[0] >= 0xC2 && u[0] <= 0xDF && n >= 2 && (u[1] & 0xC0) == 0x80) {
+        *len = 2;
+        return fold_codepoint(((uint32_t)(u[0] & 0x1F) << 6) | (u[1] & 0x3F));
+    }
+    if((u[0] & 0xF0) == 0xE0 && n >= 3 && (u[1] & 0xC0) == 0x80 && (u[2] & 0xC0) == 0x80) {
+        uint32_t cp = ((uint32_t)(u[0] & 0x0F) << 12) | ((uint32_t)(u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+        if(cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF)) {
+            *len = 3;
+            return cp;
+        }
+    }
+    if((u[0] & 0xF8) == 0xF0 && n >= 4 && (u[1] & 0xC0) == 0x80 && (u[2] & 0xC0) == 0x80 && (u[3] & 0xC0) == 0x80) {
+        uint32_t cp = ((uint32_t)(u[0] & 0x07) << 18) | ((uint32_t)(u[1] & 0x3F) << 12) | ((uint32_t)(u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+        if(cp >= 0x10000 && cp <= 0x10FFFF) {
+            *len = 4;
+            return cp;
+        }
+    }
+    *len = 1;
+    return 0x200000 | u[0];
+};
+#endif
+
+#ifdef __SSE2__
+/*
+ * Folds the ASCII capitals in 16 bytes at once: 'A'..'Z' are moved to the bottom of the signed range and selected
+ * with a single compare
+ */
+static inline __m128i fold_ascii_sse2(__m128i x) {
+    __m128i shifted = _mm_add_epi8(x, _mm_set1_epi8((char)(128 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + 26)));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+/*
+ * Returns the index of the first of n bytes that differs between s1 and s2 after ASCII folding, or n. 
+ * In KLIB_FOLD_UTF8 mode the vector loop stops at the first block containing a non-ASCII byte, and the 
+ * returned index is only a point up to which the Strings are known to be equal
+ */
+static size_t mismatch_ci(const char* s1, const char* s2, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i+16 <= n; i+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s1+i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s2+i));
+#ifdef KLIB_FOLD_UTF8
+        if(_mm_movemask_epi8(_mm_or_si128(a, b)) != 0)
+            return i;
+#endif
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(fold_ascii_sse2(a), fold_ascii_sse2(b)));
+        if(mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+    for(; i<n; i++) {
+#ifdef KLIB_FOLD_UTF8
+        if((unsigned char)(s1[i] | s2[i]) >= 0x80)
+            return i;
+#endif
+        if(fold_ascii((unsigned char)s1[i]) != fold_ascii((unsigned char)s2[i]))
+            return i;
+    }
+    return n;
+};
+
+/*
+ * Compares n1 bytes of s1 with n2 bytes of s2 after case folding, returning -1, 0 or 1
+ */
+static int compare_ci(const char* s1, size_t n1, const char* s2, size_t n2) {
+    size_t n = n1 < n2 ? n1 : n2;
+    size_t i = mismatch_ci(s1, s2, n);
+#ifdef KLIB_FOLD_UTF8
+    size_t j = i;
+    while(i < n1 && j < n2) {
+        size_t l1, l2;
+        uint32_t c1 = fold_utf8_next(s1+i, n1-i, &l1);
+        uint32_t c2 = fold_utf8_next(s2+j, n2-j, &l2);
+        if(c1 != c2)
+            return c1 < c2 ? -1 : 1;
+        i += l1;
+        j += l2;
+    }
+    return (i < n1) - (j < n2);
+#else
+    if(i < n) {
+        unsigned char c1 = fold_ascii((unsigned char)s1[i]);
+        unsigned char c2 = fold_ascii((unsigned char)s2[i]);
+        return c1 < c2 ? -1 : 1;
+    }
+    return (n1 > n2) - (n1 < n2);
+#endif
+};
+
+/*
+ * Returns the index of the first case-insensitive match of the m bytes of needle in the n bytes of haystack, 
+ * or (size_t)-1. In ASCII mode, 16 candidate positions are filtered at once by testing the first and last 
+ * characters of needle before a candidate is compared in full
+ */
+static size_t find_ci(const char* haystack, size_t n, const char* needle, size_t m) {
+    if(m == 0)
+        return 0;
+    if(m > n)
+        return (size_t)-1;
+#ifdef KLIB_FOLD_UTF8
+    size_t len;
+    for(size_t i=0; i+m <= n; i+=len) {
+        if(compare_ci(haystack+i, m, needle, m) == 0)
+            return i;
+        fold_utf8_next(haystack+i, n-i, &len);
+    }
+    return (size_t)-1;
+#else
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8((char)fold_ascii((unsigned char)needle[0]));
+    __m128i last = _mm_set1_epi8((char)fold_ascii((unsigned char)needle[m-1]));
+    for(; i+m-1+16 <= n; i+=16) {
+        __m128i a = fold_ascii_sse2(_mm_loadu_si128((const __m128i*)(haystack+i)));
+        __m128i b = fold_ascii_sse2(_mm_loadu_si128((const __m128i*)(haystack+i+m-1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while(mask != 0) {
+            size_t candidate = i + __builtin_ctz(mask);
+            if(mismatch_ci(haystack+candidate, needle, m) == m)
+                return candidate;
+            mask &= mask-1;
+        }
+    }
+#endif
+    for(; i+m <= n; i++) {
+        if(mismatch_ci(haystack+i, needle, m) == m)
+            return i;
+    }
+    return (size_t)-1;
+#endif
+};
+
+/*
+ * Hex and base64 kernels. Each function runs the widest vector loop the target was compiled for (AVX2, then SSSE3) 
+ * and finishes the remaining bytes with the scalar loop. The output buffer must already be large enough
+ */
+
+#ifdef __SSSE3__
+static inline __m128i base64_reshuffle_ssse3(__m128i in) {
+    // spread each group of 3 bytes over 4 bytes, then move each 6-bit field to the bottom of its byte
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+static inline __m128i base64_translate_ssse3(__m128i in) {
+    // offset from each 6-bit value to its character, looked up by range: A-Z, a-z, 0-9, '+', '/'
+    const __m128i offsets = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i index = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    index = _mm_sub_epi8(index, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+    return _mm_add_epi8(in, _mm_shuffle_epi8(offsets, index));
+}
+
+/*
+ * Converts 16 base64 characters to their 6-bit values and packs them into the first 12 bytes of out. 
+ * Returns 0 without writing if any character is outside the alphabet (including '=')
+ */
+static inline int base64_decode_ssse3(__m128i in, unsigned char* out) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+    __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+    __m128i loNibbles = _mm_and_si128(in, mask2F);
+    __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    if(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+        return 0;
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask2F), hiNibbles));
+    in = _mm_add_epi8(in, roll);
+    in = _mm_madd_epi16(_mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    unsigned char block[16];
+    _mm_storeu_si128((__m128i*)block, in);
+    memcpy(out, block, 12);
+    return 1;
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i base64_reshuffle_avx2(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                  1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t0, t1);
+}
+
+static inline __m256i base64_translate_avx2(__m256i in) {
+    const __m256i offsets = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                             65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i index = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    index = _mm256_sub_epi8(index, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+    return _mm256_add_epi8(in, _mm256_shuffle_epi8(offsets, index));
+}
+
+/*
+ * Converts 32 base64 characters into the first 24 bytes of out, see base64_decode_ssse3
+ */
+static inline int base64_decode_avx2(__m256i in, unsigned char* out) {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+    __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask2F);
+    __m256i loNibbles = _mm256_and_si256(in, mask2F);
+    __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+    __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+    if(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0)
+        return 0;
+    __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask2F), hiNibbles));
+    in = _mm256_add_epi8(in, roll);
+    in = _mm256_madd_epi16(_mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    unsigned char block[32];
+    _mm256_storeu_si256((__m256i*)block, in);
+    memcpy(out, block, 24);
+    return 1;
+}
+#endif
+
+static void hex_encode(const unsigned char* src, size_t n, char* out) {
+    const char* digits = "0123456789abcdef";
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i lut256 = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    for(; i+32 <= n; i+=32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i hi = _mm256_shuffle_epi8(lut256, _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f)));
+        __m256i lo = _mm256_shuffle_epi8(lut256, _mm256_and_si256(v, _mm256_set1_epi8(0x0f)));
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(out+2*i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(out+2*i+32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+#endif
+#ifdef __SSSE3__
+    const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    for(; i+16 <= n; i+=16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, _mm_set1_epi8(0x0f)));
+        _mm_storeu_si128((__m128i*)(out+2*i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(out+2*i+16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    for(; i<n; i++) {
+        out[2*i] = digits[src[i] >> 4];
+        out[2*i+1] = digits[src[i] & 0x0f];
+    }
+};
+
+/*
+ * Decodes n hex digits (n even, either case) into n/2 bytes. Returns 0 if a character is not a hex digit
+ */
+static int hex_decode(const char* src, size_t n, unsigned char* out) {
+    size_t i = 0;
+#ifdef __AVX2__
+    for(; i+32 <= n; i+=32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        __m256i l = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+        __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+        if(_mm256_movemask_epi8(_mm256_or_si256(isDigit, isAlpha)) != -1)
+            return 0;
+        __m256i val = _mm256_or_si256(_mm256_and_si256(isDigit, d), _mm256_and_si256(isAlpha, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+        __m256i pairs = _mm256_maddubs_epi16(val, _mm256_set1_epi16(0x0110));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i*)(out+i/2), _mm256_castsi256_si128(packed));
+    }
+#endif
+#ifdef __SSSE3__
+    for(; i+16 <= n; i+=16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+        __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+        if(_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xFFFF)
+            return 0;
+        __m128i val = _mm_or_si128(_mm_and_si128(isDigit, d), _mm_and_si128(isAlpha, _mm_add_epi8(l, _mm_set1_epi8(10))));
+        __m128i pairs = _mm_maddubs_epi16(val, _mm_set1_epi16(0x0110));
+        _mm_storel_epi64((__m128i*)(out+i/2), _mm_packus_epi16(pairs, pairs));
+    }
+#endif
+    for(; i<n; i+=2) {
+        int v[2];
+        for(int k=0; k<2; k++) {
+            unsigned char c = (unsigned char)src[i+k];
+            if(c >= '0' && c <= '9')
+                v[k] = c - '0';
+            else if((c|0x20) >= 'a' && (c|0x20) <= 'f')
+                v[k] = (c|0x20) - 'a' + 10;
+            else
+                return 0;
+        }
+        out[i/2] = (unsigned char)(v[0] << 4 | v[1]);
+    }
+    return 1;
+};
+
+static void base64_encode(const unsigned char* src, size_t n, char* out) {
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    size_t o = 0;
+#ifdef __AVX2__
+    // two overlapping 16-byte loads put 12 input bytes in each lane
+    for(; i+28 <= n; i+=24, o+=32) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src+i))),
+                                            _mm_loadu_si128((const __m128i*)(src+i+12)), 1);
+        _mm256_storeu_si256((__m256i*)(out+o), base64_translate_avx2(base64_reshuffle_avx2(v)));
+    }
+#endif
+#ifdef __SSSE3__
+    for(; i+16 <= n; i+=12, o+=16)
+        _mm_storeu_si128((__m128i*)(out+o), base64_translate_ssse3(base64_reshuffle_ssse3(_mm_loadu_si128((const __m128i*)(src+i)))));
+#endif
+    for(; i+3 <= n; i+=3, o+=4) {
+        uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i+1] << 8 | src[i+2];
+        out[o] = alphabet[v >> 18];
+        out[o+1] = alphabet[(v >> 12) & 0x3f];
+        out[o+2] = alphabet[(v >> 6) & 0x3f];
+        out[o+3] = alphabet[v & 0x3f];
+    }
+    if(i < n) {
+        uint32_t v = (uint32_t)src[i] << 16 | (i+1 < n ? (uint32_t)src[i+1] << 8 : 0);
+        out[o] = alphabet[v >> 18];
+        out[o+1] = alphabet[(v >> 12) & 0x3f];
+        out[o+2] = i+1 < n ? alphabet[(v >> 6) & 0x3f] : '=';
+        out[o+3] = '=';
+    }
+};
+
+static int base64_value(unsigned char c) {
+    if(c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if(c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if(c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if(c == '+')
+        return 62;
+    if(c == '/')
+        return 63;
+    return -1;
+};
+
+/*
+ * Decodes n base64 characters (n a multiple of 4, '=' padding only in the last two positions). 
+ * Returns 0 if the input is malformed
+ */
+static int base64_decode(const char* src, size_t n, unsigned char* out) {
+    size_t i = 0;
+    size_t o = 0;
+#ifdef __SSSE3__
+    // the vector loops stop at the first block containing padding or an invalid character, leaving it to the scalar loop
+#ifdef __AVX2__
+    for(; i+32 <= n; i+=32, o+=24) {
+        if(!base64_decode_avx2(_mm256_loadu_si256((const __m256i*)(src+i)), out+o))
+            break;
+    }
+#endif
+    for(; i+16 <= n; i+=16, o+=12) {
+        if(!base64_decode_ssse3(_mm_loadu_si128((const __m128i*)(src+i)), out+o))
+            break;
+    }
+#endif
+    for(; i<n; i+=4, o+=3) {
+        const unsigned char* q = (const unsigned char*)src + i;
+        int last = i+4 == n;
+        int a = base64_value(q[0]);
+        int b = base64_value(q[1]);
+        int c = (last && q[2] == '=' && q[3] == '=') ? 0 : base64_value(q[2]);
+        int d = (last && q[3] == '=') ? 0 : base64_value(q[3]);
+        if(a < 0 || b < 0 || c < 0 || d < 0)
+            return 0;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+        out[o] = (unsigned char)(v >> 16);
+        if(!last || q[2] != '=')
+            out[o+1] = (unsigned char)(v >> 8);
+        if(!last || q[3] != '=')
+            out[o+2] = (unsigned char)v;
+    }
+    return 1;
+};
+
+#ifdef KLIB_NO_EXIT
+#ifdef __cplusplus
+#define KLIB_THREAD_LOCAL thread_local
+#else
+#define KLIB_THREAD_LOCAL _Thread_local
+#endif
+static KLIB_THREAD_LOCAL char klib_error_message[256];
+static KLIB_THREAD_LOCAL int klib_error_set = 0;
+#endif
+
 void print_error(const char* func, const char* msg) {
+#ifdef KLIB_NO_EXIT
+    snprintf(klib_error_message, sizeof(klib_error_message), "Error in function %s: %s", func, msg);
+    klib_error_set = 1;
+#else
     fprintf(stderr, "Error in function %s: %s\n", func, msg);
     exit(1);
+#endif
+};
+
+/*
+ * Replaces up to max occurences of needle in str. 
+ * The matches are counted first so the result can be sized exactly: if repl is not longer than needle the
+ * buffer is rewritten in place, otherwise a single buffer of the final size is allocated and filled with memcpy.
+ */
+static String* replace_occurrences(String* str, const char* needle, const char* repl, size_t max) {
+    size_t n = strlen(needle);
+    size_t r = strlen(repl);
+
+    size_t count = 0;
+    for(char* p = strstr(str->buffer, needle); p != NULL; p = strstr(p+n, needle)) {
+        if(++count == max)
+            break;
+    }
+    if(count == 0)
+        return str;
+
+    size_t newSize = str->size - count*n + count*r;
+#ifdef KLIB_COW
+    if(r <= n)
+        string_detach(str);
+#endif
+    char* src = str->buffer;
+    char* dest = str->buffer;
+    if(r > n) {
+        str->bufferSize = newSize*sizeof(char)+1;
+        dest = string_buffer_alloc(str->bufferSize);
+    }
+
+    char* out = dest;
+    for(size_t i=0; i<count; i++) {
+        char* match = strstr(src, needle);
+        size_t prefix = match - src;
+        memmove(out, src, prefix);
+        out += prefix;
+        memcpy(out, repl, r);
+        out += r;
+        src = match + n;
+    }
+    memmove(out, src, str->buffer + str->size - src + 1);
+
+    if(dest != str->buffer) {
+        string_buffer_release(str->buffer);
+        str->buffer = dest;
+    }
+    str->size = newSize;
+    return str;
+};
+
+// ##########################################################
+//                     Error Functions
+// ##########################################################
+
+/*
+ * @brief    Returns the last error recorded on this thread. 
+             Errors are only recorded when KLIB_NO_EXIT is defined, otherwise a failed check exits the process
+ * @param    none
+ * @returns  A description of the last error, or NULL if no error occurred since the last call to string_clear_error
+ */
+const char* string_last_error() {
+#ifdef KLIB_NO_EXIT
+    return klib_error_set ? klib_error_message : NULL;
+#else
+    return NULL;
+#endif
+};
+
+/*
+ * @brief    Clears the last error recorded on this thread
+ * @param    none
+ * @returns  none
+ */
+void string_clear_error() {
+#ifdef KLIB_NO_EXIT
+    klib_error_set = 0;
+#endif
 };
 
 // ##########################################################
@@ -75,7 +1058,7 @@ void print_error(const char* func, const char* msg) {
 String* new_string() {
     String* str;
     str = (String*)malloc(sizeof(String));
-    str->buffer = (char*)malloc(1*sizeof(char));
+    str->buffer = string_buffer_alloc(1*sizeof(char));
     str->buffer[0] = '\0';
     str->bufferSize = 1;
     str->size = 0;
@@ -89,9 +1072,8 @@ String* new_string() {
  * @returns  none
  */
 void free_string(String* str) {
-    if(str == NULL) 
-        print_error("free_string", "argument str cannot be NULL");
-    free(str->buffer);
+    KLIB_CHECK_VOID(str == NULL, "free_string", "argument str cannot be NULL");
+    string_buffer_release(str->buffer);
     free(str);
 };
 
@@ -102,8 +1084,7 @@ void free_string(String* str) {
  * @returns  str->size
  */
 size_t string_size(String* str) {
-    if(str == NULL) 
-        print_error("string_size", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "string_size", "argument str cannot be NULL", 0);
     return str->size;
 };
 
@@ -114,8 +1095,7 @@ size_t string_size(String* str) {
  * @returns  str->buffer
  */
 char* c_string(String* str) {
-    if(str == NULL) 
-        print_error("c_string", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "c_string", "argument str cannot be NULL", NULL);
     return str->buffer;
 };
 
@@ -128,10 +1108,8 @@ char* c_string(String* str) {
  * @returns  the character at index c within the buffer
  */
 char get_index(String* str, size_t index) {
-    if(str == NULL) 
-        print_error("get_index", "argument str cannot be NULL");
-    if(index >= str->size)
-        print_error("get_index", "argument index must be in the range [0, str->size)");
+    KLIB_CHECK(str == NULL, "get_index", "argument str cannot be NULL", '\0');
+    KLIB_CHECK(index >= str->size, "get_index", "argument index must be in the range [0, str->size)", '\0');
     return str->buffer[index];
 };
 
@@ -144,13 +1122,26 @@ char get_index(String* str, size_t index) {
  * @returns  none
  */
 void set_index(String* str, size_t index, char c) {
-    if(str == NULL) 
-        print_error("set_index", "argument str cannot be NULL");
-    if(index >= str->size)
-        print_error("set_index", "argument index must be in the range [0, str->size)");
+    KLIB_CHECK_VOID(str == NULL, "set_index", "argument str cannot be NULL");
+    KLIB_CHECK_VOID(index >= str->size, "set_index", "argument index must be in the range [0, str->size)");
+#ifdef KLIB_COW
+    string_detach(str);
+#endif
     str->buffer[index] = c;
 };
 
+/*
+ * @brief    Gives str its own copy of its buffer if the buffer is shared with other Strings. 
+             Only needed in KLIB_COW mode, before writing to the buffer returned by c_string. 
+             Exits with code 1 if str is NULL
+ * @param    str - the String that is detached
+ * @returns  none
+ */
+void string_detach(String* str) {
+    KLIB_CHECK_VOID(str == NULL, "string_detach", "argument str cannot be NULL");
+    string_reserve(str, 0);
+};
+
 /*
  * @brief    Sets the internal buffer of the string to a specified value, overwriting anything that may have been there already. 
              Exits with code 1 if str is NULL
@@ -159,13 +1150,9 @@ void set_index(String* str, size_t index, char c) {
  * @returns  none
  */
 void string_set(String* str, const char* src) {
-    if(str == NULL) 
-        print_error("string_set", "argument str cannot be NULL");
+    KLIB_CHECK_VOID(str == NULL, "string_set", "argument str cannot be NULL");
     size_t s = strlen(src);
-    if(s >= str->bufferSize) {
-        str->bufferSize = s*sizeof(char)+1;
-        str->buffer = (char*)realloc(str->buffer, str->bufferSize);
-    }
+    string_reserve(str, s*sizeof(char)+1);
     memset(str->buffer, '\0', str->bufferSize);
     strcpy(str->buffer, src);
     str->size = s;
@@ -190,13 +1177,17 @@ String* new_set_string(const char* str) {
  * @returns  A pointer to the newly created String
  */
 String* new_copy_string(String* str) {
-    if(str == NULL)
-        print_error("new_copy_string", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "new_copy_string", "argument str cannot be NULL", NULL);
     String* newstr = (String*)malloc(sizeof(String));
     newstr->size = str->size;
     newstr->bufferSize = str->bufferSize;
-    newstr->buffer = (char*)malloc(sizeof(char)*newstr->bufferSize);
+#ifdef KLIB_COW
+    __atomic_fetch_add(&STRING_BUFFER_HEADER(str->buffer)->refs, 1, __ATOMIC_RELAXED);
+    newstr->buffer = str->buffer;
+#else
+    newstr->buffer = string_buffer_alloc(sizeof(char)*newstr->bufferSize);
     strcpy(newstr->buffer, str->buffer);
+#endif
     return newstr;
 };
 
@@ -217,12 +1208,15 @@ void print_string(String* str) {
  * @returns  the paramater str
  */
 String* to_lowercase(String* str) {
-    if(str == NULL)
-        print_error("to_lowercase", "argument str cannot be NULL");
-    for(size_t i=0; i<str->size; i++) {
-        char c = get_index(str, i);
-        if(c >= 65 && c <= 90)
-            set_index(str, i, (c+32));
+    KLIB_CHECK(str == NULL, "to_lowercase", "argument str cannot be NULL", NULL);
+#ifdef KLIB_COW
+    string_detach(str);
+#endif
+    char* buf = c_string_unchecked(str);
+    size_t s = string_size_unchecked(str);
+    for(size_t i=0; i<s; i++) {
+        char c = buf[i];
+        buf[i] = (c >= 65 && c <= 90) ? c+32 : c;
     }
     return str;
 };
@@ -233,12 +1227,15 @@ String* to_lowercase(String* str) {
  * @returns  the parameter str
  */
 String* to_uppercase(String* str) {
-    if(str == NULL)
-        print_error("to_uppercase", "argument str cannot be NULL");
-    for(size_t i=0; i<str->size; i++) {
-        char c = get_index(str, i);
-        if(c >= 97 && c <= 122)
-            set_index(str, i, (c-32));
+    KLIB_CHECK(str == NULL, "to_uppercase", "argument str cannot be NULL", NULL);
+#ifdef KLIB_COW
+    string_detach(str);
+#endif
+    char* buf = c_string_unchecked(str);
+    size_t s = string_size_unchecked(str);
+    for(size_t i=0; i<s; i++) {
+        char c = buf[i];
+        buf[i] = (c >= 97 && c <= 122) ? c-32 : c;
     }
     return str;
 };
@@ -249,14 +1246,13 @@ String* to_uppercase(String* str) {
  * @returns  the parameter str
  */
 String* lstrip(String* str) {
-    if(str == NULL)
-        print_error("lstrip", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "lstrip", "argument str cannot be NULL", NULL);
     size_t s = str->size;
     if(s == 0)
         return str;
     size_t first = 0;
     for(size_t i=0; i<s; i++) {
-        char c = get_index(str, i);
+        char c = get_index_unchecked(str, i);
         if(c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '\x0b'){
             first = i;
             break;
@@ -279,14 +1275,13 @@ String* lstrip(String* str) {
  * @returns  the parameter str
  */
 String* rstrip(String* str) {
-    if(str == NULL)
-        print_error("lstrip", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "rstrip", "argument str cannot be NULL", NULL);
     size_t s = str->size;
     if(s == 0)
         return str;
     size_t first = s-1;
     for(size_t i=0; i<s; i++) {
-        char c = get_index(str, s-i-1);
+        char c = get_index_unchecked(str, s-i-1);
         if(c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '\x0b'){
             first = s-i-1;
             break;
@@ -324,15 +1319,10 @@ String* strip(String* str) {
  * @returns  none
  */
 void string_copy_c(String* dest, char* src) {
-    if(dest == NULL) 
-        print_error("string_copy_c", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_copy_c", "argument src cannot be NULL");
+    KLIB_CHECK_VOID(dest == NULL, "string_copy_c", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_copy_c", "argument src cannot be NULL");
     size_t s = strlen(src);
-    if(s >= dest->bufferSize) {
-        dest->bufferSize = s*sizeof(char)+1;
-        dest->buffer = (char*)realloc(dest->buffer, dest->bufferSize);
-    }
+    string_reserve(dest, s*sizeof(char)+1);
 
     memset(dest->buffer, '\0', dest->bufferSize);
     strcpy(dest->buffer, src);
@@ -347,11 +1337,19 @@ void string_copy_c(String* dest, char* src) {
  * @returns  none
  */
 void string_copy(String* dest, String* src) {
-    if(dest == NULL) 
-        print_error("string_copy", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_copy", "argument src cannot be NULL");
+    KLIB_CHECK_VOID(dest == NULL, "string_copy", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_copy", "argument src cannot be NULL");
+#ifdef KLIB_COW
+    if(dest->buffer == src->buffer)
+        return;
+    __atomic_fetch_add(&STRING_BUFFER_HEADER(src->buffer)->refs, 1, __ATOMIC_RELAXED);
+    string_buffer_release(dest->buffer);
+    dest->buffer = src->buffer;
+    dest->bufferSize = src->bufferSize;
+    dest->size = src->size;
+#else
     string_copy_c(dest, src->buffer);
+#endif
 };
 
 /*
@@ -363,18 +1361,12 @@ void string_copy(String* dest, String* src) {
  * @returns  none
  */
 void string_n_copy_c(String* dest, char* src, size_t num) {
+    KLIB_CHECK_VOID(dest == NULL, "string_n_copy_c", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_n_copy_c", "argument src cannot be NULL");
     size_t s = strlen(src);
-    if(dest == NULL) 
-        print_error("string_n_copy_c", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_n_copy_c", "argument src cannot be NULL");
-    if(num > s)
-        print_error("string_n_copy_c", "num cannot be greater than strlen(src)");
+    KLIB_CHECK_VOID(num > s, "string_n_copy_c", "num cannot be greater than strlen(src)");
 
-    if(num >= dest->bufferSize) {
-        dest->bufferSize = num*sizeof(char)+1;
-        dest->buffer = (char*)realloc(dest->buffer, dest->bufferSize);
-    }
+    string_reserve(dest, num*sizeof(char)+1);
     memset(dest->buffer, '\0', dest->bufferSize);
     strncpy(dest->buffer, src, num);
     dest->size = num;
@@ -389,12 +1381,9 @@ void string_n_copy_c(String* dest, char* src, size_t num) {
  * @returns  none
  */
 void string_n_copy(String* dest, String* src, size_t num) {
-    if(dest == NULL) 
-        print_error("string_n_copy", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_n_copy", "argument src cannot be NULL");
-    if(num > src->size)
-        print_error("string_n_copy", "num cannot be greater than strlen(src)");
+    KLIB_CHECK_VOID(dest == NULL, "string_n_copy", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_n_copy", "argument src cannot be NULL");
+    KLIB_CHECK_VOID(num > src->size, "string_n_copy", "num cannot be greater than strlen(src)");
     string_n_copy_c(dest, src->buffer, num);
 };
 
@@ -410,16 +1399,11 @@ void string_n_copy(String* dest, String* src, size_t num) {
  * @returns  none
  */
 void string_append_c(String* dest, char* src) {
+    KLIB_CHECK_VOID(dest == NULL, "string_append_c", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_append_c", "argument src cannot be NULL");
     size_t s = strlen(src);
-    if(dest == NULL) 
-        print_error("string_append_c", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_append_c", "argument src cannot be NULL");
     
-    if(dest->size+s >= dest->bufferSize) {
-        dest->bufferSize = (dest->size+s)*sizeof(char)+1;
-        dest->buffer = (char*)realloc(dest->buffer, dest->bufferSize);
-    }
+    string_reserve(dest, (dest->size+s)*sizeof(char)+1);
     strcat(dest->buffer, src);
     dest->size += s;
 };
@@ -432,10 +1416,8 @@ void string_append_c(String* dest, char* src) {
  * @returns  none
  */
 void string_append(String* dest, String* src) {
-    if(dest == NULL) 
-        print_error("string_append", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_append", "argument src cannot be NULL");
+    KLIB_CHECK_VOID(dest == NULL, "string_append", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_append", "argument src cannot be NULL");
     string_append_c(dest, src->buffer);
 };
 
@@ -448,18 +1430,12 @@ void string_append(String* dest, String* src) {
  * @returns  none
  */
 void string_n_append_c(String* dest, char* src, size_t num) {
+    KLIB_CHECK_VOID(dest == NULL, "string_n_append_c", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_n_append_c", "argument src cannot be NULL");
     size_t s = strlen(src);
-    if(dest == NULL) 
-        print_error("string_n_append_c", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_n_append_c", "argument src cannot be NULL");
-    if(num > s)
-        print_error("tring_n_append_c", "num cannot be greater than strlen(src)");
+    KLIB_CHECK_VOID(num > s, "string_n_append_c", "num cannot be greater than strlen(src)");
 
-    if((dest->size+num) >= dest->bufferSize) {
-        dest->bufferSize = (dest->size+num)*sizeof(char)+1;
-        dest->buffer = (char*)realloc(dest->buffer, dest->bufferSize);
-    }
+    string_reserve(dest, (dest->size+num)*sizeof(char)+1);
     strncat(dest->buffer, src, num);
     dest->size += s;
 };
@@ -473,15 +1449,66 @@ void string_n_append_c(String* dest, char* src, size_t num) {
  * @returns  none
  */
 void string_n_append(String* dest, String* src, size_t num) {
-    if(dest == NULL) 
-        print_error("string_n_append", "argument dest cannot be NULL");
-    if(src == NULL) 
-        print_error("string_n_append", "argument src cannot be NULL");
-    if(num > src->size)
-        print_error("tring_n_append", "num cannot be greater than strlen(src)");
+    KLIB_CHECK_VOID(dest == NULL, "string_n_append", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_n_append", "argument src cannot be NULL");
+    KLIB_CHECK_VOID(num > src->size, "string_n_append", "num cannot be greater than strlen(src)");
     string_n_append_c(dest, src->buffer, num);
 };
 
+/*
+ * @brief    Joins count Strings into a new String, with sep placed between each pair of Strings. 
+             The length of the result is computed first, so the buffer is allocated exactly once. 
+             It is the caller's responsibility to free the returned string appropriately. 
+             Exits with code 1 if sep is NULL, if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    strs - the Strings to be joined
+ * @param    count - the number of Strings in strs
+ * @param    sep - the c-style string placed between the Strings
+ * @returns  A pointer to a new String, containing the joined Strings
+ */
+String* string_join_c(String** strs, unsigned int count, char* sep) {
+    KLIB_CHECK(strs == NULL && count > 0, "string_join_c", "argument strs cannot be NULL", NULL);
+    KLIB_CHECK(sep == NULL, "string_join_c", "argument sep cannot be NULL", NULL);
+    size_t s = strlen(sep);
+    size_t total = 0;
+    for(unsigned int i=0; i<count; i++) {
+        KLIB_CHECK(strs[i] == NULL, "string_join_c", "elements of strs cannot be NULL", NULL);
+        total += strs[i]->size;
+    }
+    if(count > 1)
+        total += (count-1)*s;
+
+    String* joined = (String*)malloc(sizeof(String));
+    joined->bufferSize = total*sizeof(char)+1;
+    joined->buffer = string_buffer_alloc(joined->bufferSize);
+    joined->size = total;
+
+    char* out = joined->buffer;
+    for(unsigned int i=0; i<count; i++) {
+        if(i > 0) {
+            memcpy(out, sep, s);
+            out += s;
+        }
+        memcpy(out, strs[i]->buffer, strs[i]->size);
+        out += strs[i]->size;
+    }
+    *out = '\0';
+    return joined;
+};
+
+/*
+ * @brief    Joins count Strings into a new String, with the buffer of sep placed between each pair of Strings. 
+             It is the caller's responsibility to free the returned string appropriately. 
+             Exits with code 1 if sep is NULL, if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    strs - the Strings to be joined
+ * @param    count - the number of Strings in strs
+ * @param    sep - the String placed between the Strings
+ * @returns  A pointer to a new String, containing the joined Strings
+ */
+String* string_join(String** strs, unsigned int count, String* sep) {
+    KLIB_CHECK(sep == NULL, "string_join", "argument sep cannot be NULL", NULL);
+    return string_join_c(strs, count, sep->buffer);
+};
+
 // ##########################################################
 //                  Comparison Functions
 // ##########################################################
@@ -497,10 +1524,8 @@ void string_n_append(String* dest, String* src, size_t num) {
  *           >0 indicates the first character that does not match has a greater value in ptr1 than in ptr2. 
  */
 int string_compare_c (String* str1, char* str2) {
-    if(str1 == NULL)
-        print_error("string_compare_c", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("string_compare_c", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "string_compare_c", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare_c", "argument str2 cannot be NULL", 0);
     return strcmp(str1->buffer, str2);
 };
 
@@ -515,10 +1540,8 @@ int string_compare_c (String* str1, char* str2) {
  *           >0 indicates the first character that does not match has a greater value in ptr1 than in ptr2. 
  */
 int string_compare (String* str1, String* str2) {
-    if(str1 == NULL)
-        print_error("string_compare", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("string_compare", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "string_compare", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare", "argument str2 cannot be NULL", 0);
     return strcmp(str1->buffer, str2->buffer);
 };
 
@@ -530,10 +1553,8 @@ int string_compare (String* str1, String* str2) {
  * @returns  1 if the strings are equal, 0 otherwise.
  */
 int string_equal_c (String* str1, char* str2) {
-    if(str1 == NULL)
-        print_error("string_compare", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("string_compare", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "string_compare", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare", "argument str2 cannot be NULL", 0);
     return !strcmp(str1->buffer, str2);
 };
 
@@ -545,13 +1566,68 @@ int string_equal_c (String* str1, char* str2) {
  * @returns  1 if the strings are equal, 0 otherwise.
  */
 int string_equal (String* str1, String* str2) {
-    if(str1 == NULL)
-        print_error("string_compare", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("string_compare", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "string_compare", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare", "argument str2 cannot be NULL", 0);
     return !strcmp(str1->buffer, str2->buffer);
 };
 
+/*
+ * @brief    Compares str1 to str2, ignoring case. Case is folded on the fly, without allocating. 
+             Exits with code 1 if either str1 or str2 are NULL. 
+ * @param    str1 - The first String to be compared
+ * @param    str2 - the second c-style string to be compared
+ * @returns  -1, 0 or 1 if str1 is less than, equal to or greater than str2 after case folding
+ */
+int string_compare_ci_c (String* str1, char* str2) {
+    KLIB_CHECK(str1 == NULL, "string_compare_ci_c", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare_ci_c", "argument str2 cannot be NULL", 0);
+    return compare_ci(str1->buffer, str1->size, str2, strlen(str2));
+};
+
+/*
+ * @brief    Compares str1 to str2, ignoring case. Case is folded on the fly, without allocating. 
+             Exits with code 1 if either str1 or str2 are NULL. 
+ * @param    str1 - The first String to be compared
+ * @param    str2 - the second String to be compared
+ * @returns  -1, 0 or 1 if str1 is less than, equal to or greater than str2 after case folding
+ */
+int string_compare_ci (String* str1, String* str2) {
+    KLIB_CHECK(str1 == NULL, "string_compare_ci", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_compare_ci", "argument str2 cannot be NULL", 0);
+    return compare_ci(str1->buffer, str1->size, str2->buffer, str2->size);
+};
+
+/*
+ * @brief    Checks if str1 equals str2, ignoring case. 
+             Exits with code 1 if either str1 or str2 are NULL. 
+ * @param    str1 - The first String to be compared
+ * @param    str2 - the second c-style string to be compared
+ * @returns  1 if the strings are equal after case folding, 0 otherwise.
+ */
+int string_equal_ci_c (String* str1, char* str2) {
+    KLIB_CHECK(str1 == NULL, "string_equal_ci_c", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_equal_ci_c", "argument str2 cannot be NULL", 0);
+    size_t s = strlen(str2);
+    if(s != str1->size)
+        return 0;
+    return compare_ci(str1->buffer, s, str2, s) == 0;
+};
+
+/*
+ * @brief    Checks if str1 equals str2, ignoring case. Strings of different sizes are rejected without being read. 
+             Exits with code 1 if either str1 or str2 are NULL. 
+ * @param    str1 - The first String to be compared
+ * @param    str2 - the second String to be compared
+ * @returns  1 if the strings are equal after case folding, 0 otherwise.
+ */
+int string_equal_ci (String* str1, String* str2) {
+    KLIB_CHECK(str1 == NULL, "string_equal_ci", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_equal_ci", "argument str2 cannot be NULL", 0);
+    if(str1->size != str2->size)
+        return 0;
+    return compare_ci(str1->buffer, str1->size, str2->buffer, str2->size) == 0;
+};
+
 // ##########################################################
 //                  Searching Functions
 // ##########################################################
@@ -564,8 +1640,7 @@ int string_equal (String* str1, String* str2) {
  * @returns  The index of the first occurence of c in str, or -1 if c is not found
  */
 size_t find_char(String* str, char c) {
-    if(str == NULL) 
-        print_error("find_char", "argument str cannot be NULL");
+    KLIB_CHECK(str == NULL, "find_char", "argument str cannot be NULL", -1);
     char* pch = strchr(str->buffer, c);
     if(pch == NULL)
         return -1;
@@ -575,17 +1650,17 @@ size_t find_char(String* str, char c) {
 /*
  * @brief    Splits str into tokens, along the characters specified in delimiters. 
              It is the caller's responsibility to free the returned strings appropriately. 
-             Exits with code 1 if either str or delimiters is NULL
+             Exits with code 1 if str, delimiters or c is NULL
  * @param    str - String to be tokenized
  * @param    delimiters - c-style string containing all delimiters
- * @param    c - the number of tokens found
+ * @param    c - the number of tokens found. Set to 0 if no token is found or a check fails
  * @returns  If a token is found, a pointer to the beginning of the token, otherwise NULL
  */
 String** tokenize_c(String* str, const char* delimiters, unsigned int* c) {
-    if(str == NULL) 
-        print_error("tokenize_c", "argument str cannot be NULL");
-    if(delimiters == NULL) 
-        print_error("tokenize_c", "argument delimiters cannot be NULL");
+    KLIB_CHECK(c == NULL, "tokenize_c", "argument c cannot be NULL", NULL);
+    *c = 0;
+    KLIB_CHECK(str == NULL, "tokenize_c", "argument str cannot be NULL", NULL);
+    KLIB_CHECK(delimiters == NULL, "tokenize_c", "argument delimiters cannot be NULL", NULL);
 
     char* temp1 = (char*)malloc(str->size*sizeof(char)+1);
     char* temp2 = (char*)malloc(str->size*sizeof(char)+1);
@@ -620,17 +1695,17 @@ String** tokenize_c(String* str, const char* delimiters, unsigned int* c) {
 /*
  * @brief    Splits str into tokens, along the characters specified in delimiters. 
              It is the user's responsibility to free the returned strings appropriately. 
-             Exits with code 1 if either str or delimiters is NULL
+             Exits with code 1 if str, delimiters or c is NULL
  * @param    str - String to be tokenized
  * @param    delimiters - String containing all delimiters
- * @param    c - the number of tokens found
+ * @param    c - the number of tokens found. Set to 0 if no token is found or a check fails
  * @returns  If a token is found, a pointer to the beginning of the token, otherwise NULL
  */
 String** tokenize(String* str, String* delimiters, unsigned int* c) {
-    if(str == NULL)
-        print_error("tokenize", "argument str cannot be NULL");
-    if(delimiters == NULL)
-        print_error("tokenize", "argument delimiters cannot be NULL");
+    KLIB_CHECK(c == NULL, "tokenize", "argument c cannot be NULL", NULL);
+    *c = 0;
+    KLIB_CHECK(str == NULL, "tokenize", "argument str cannot be NULL", NULL);
+    KLIB_CHECK(delimiters == NULL, "tokenize", "argument delimiters cannot be NULL", NULL);
     return tokenize_c(str, delimiters->buffer, c);
 };
 
@@ -642,10 +1717,8 @@ String** tokenize(String* str, String* delimiters, unsigned int* c) {
  * @returns  The index of the first occurence of str2 in str1, or -1 if str2 is not found
  */
 size_t find_substring_c(String* str1, char* str2) {
-    if(str1 == NULL)
-        print_error("find_substring_c", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("find_substring_c", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "find_substring_c", "argument str1 cannot be NULL", -1);
+    KLIB_CHECK(str2 == NULL, "find_substring_c", "argument str2 cannot be NULL", -1);
     char* pch = strstr(str1->buffer, str2);
     if(pch == NULL)
         return -1;
@@ -660,13 +1733,43 @@ size_t find_substring_c(String* str1, char* str2) {
  * @returns  The index of the first occurence of str2 in str1, or -1 if str2 is not found
  */
 size_t find_substring(String* str1, String* str2) {
-    if(str1 == NULL)
-        print_error("find_substring", "argument str1 cannot be NULL");
-    if(str2 == NULL)
-        print_error("find_substring", "argument str2 cannot be NULL");
+    KLIB_CHECK(str1 == NULL, "find_substring", "argument str1 cannot be NULL", -1);
+    KLIB_CHECK(str2 == NULL, "find_substring", "argument str2 cannot be NULL", -1);
     return find_substring_c(str1, str2->buffer);
 };
 
+/*
+ * @brief    Finds the first occurence of str2 in str1, ignoring case. Case is folded on the fly, without allocating. 
+             Exits with code 1 if either str1 or str2 are NULL
+ * @param    str1 - the String in which the substring is searched for
+ * @param    str2 - the c-style string to be located
+ * @returns  The index of the first occurence of str2 in str1, or -1 if str2 is not found, as for find_substring_c
+ */
+size_t find_substring_ci_c(String* str1, char* str2) {
+    KLIB_CHECK(str1 == NULL, "find_substring_ci_c", "argument str1 cannot be NULL", -1);
+    KLIB_CHECK(str2 == NULL, "find_substring_ci_c", "argument str2 cannot be NULL", -1);
+    size_t pos = find_ci(str1->buffer, str1->size, str2, strlen(str2));
+    if(pos == (size_t)-1)
+        return -1;
+    return pos+1;
+};
+
+/*
+ * @brief    Finds the first occurence of str2 in str1, ignoring case. 
+             Exits with code 1 if either str1 or str2 are NULL
+ * @param    str1 - the String in which the substring is searched for
+ * @param    str2 - the String to be located
+ * @returns  The index of the first occurence of str2 in str1, or -1 if str2 is not found, as for find_substring
+ */
+size_t find_substring_ci(String* str1, String* str2) {
+    KLIB_CHECK(str1 == NULL, "find_substring_ci", "argument str1 cannot be NULL", -1);
+    KLIB_CHECK(str2 == NULL, "find_substring_ci", "argument str2 cannot be NULL", -1);
+    size_t pos = find_ci(str1->buffer, str1->size, str2->buffer, str2->size);
+    if(pos == (size_t)-1)
+        return -1;
+    return pos+1;
+};
+
 /*
  * @brief    Gets the substring from str, as specified by location and length. It is the caller's responsibility to free the returned string appropriately. 
              Exits with code 1 if str is NULL. 
@@ -677,12 +1780,9 @@ size_t find_substring(String* str1, String* str2) {
  * @returns  A pointer to a new String, containing the requested substring.
  */
 String* get_substring(String* str, size_t location, size_t length) {
-    if(str == NULL)
-        print_error("get_substring", "argument str cannot be NULL");
-    if(location >= str->size)
-        print_error("get_substring", "argument location must be within the range [0, str->size)");
-    if(location+length > str->size)
-        print_error("get_substring", "sum of arguments location and length cannot exceed str->size");
+    KLIB_CHECK(str == NULL, "get_substring", "argument str cannot be NULL", NULL);
+    KLIB_CHECK(location >= str->size, "get_substring", "argument location must be within the range [0, str->size)", NULL);
+    KLIB_CHECK(location+length > str->size, "get_substring", "sum of arguments location and length cannot exceed str->size", NULL);
 
     char substr[length+1];
     for(size_t i=0; i < length; i++) {
@@ -692,3 +1792,364 @@ String* get_substring(String* str, size_t location, size_t length) {
     return new_set_string(substr);
 };
 
+// ##########################################################
+//                  Replacement Functions
+// ##########################################################
+
+/*
+ * @brief    Replaces the first occurence of needle in str with repl. 
+             Exits with code 1 if str, needle or repl are NULL. 
+             Exits with code 1 if needle is empty
+ * @param    str - the String in which the substring is replaced
+ * @param    needle - the c-style string to be replaced
+ * @param    repl - the c-style string that needle is replaced with
+ * @returns  the parameter str
+ */
+String* string_replace_c(String* str, char* needle, char* repl) {
+    KLIB_CHECK(str == NULL, "string_replace_c", "argument str cannot be NULL", NULL);
+    KLIB_CHECK(needle == NULL, "string_replace_c", "argument needle cannot be NULL", NULL);
+    KLIB_CHECK(repl == NULL, "string_replace_c", "argument repl cannot be NULL", NULL);
+    KLIB_CHECK(needle[0] == '\0', "string_replace_c", "argument needle cannot be empty", NULL);
+    return replace_occurrences(str, needle, repl, 1);
+};
+
+/*
+ * @brief    Replaces the first occurence of the buffer of needle in str with the buffer of repl. 
+             Exits with code 1 if str, needle or repl are NULL. 
+             Exits with code 1 if needle is empty
+ * @param    str - the String in which the substring is replaced
+ * @param    needle - the String to be replaced
+ * @param    repl - the String that needle is replaced with
+ * @returns  the parameter str
+ */
+String* string_replace(String* str, String* needle, String* repl) {
+    KLIB_CHECK(needle == NULL, "string_replace", "argument needle cannot be NULL", NULL);
+    KLIB_CHECK(repl == NULL, "string_replace", "argument repl cannot be NULL", NULL);
+    return string_replace_c(str, needle->buffer, repl->buffer);
+};
+
+/*
+ * @brief    Replaces every non-overlapping occurence of needle in str with repl, scanning from the start of str. 
+             The matches are counted before anything is written, so the buffer is resized at most once. 
+             Exits with code 1 if str, needle or repl are NULL. 
+             Exits with code 1 if needle is empty
+ * @param    str - the String in which the substrings are replaced
+ * @param    needle - the c-style string to be replaced
+ * @param    repl - the c-style string that needle is replaced with
+ * @returns  the parameter str
+ */
+String* string_replace_all_c(String* str, char* needle, char* repl) {
+    KLIB_CHECK(str == NULL, "string_replace_all_c", "argument str cannot be NULL", NULL);
+    KLIB_CHECK(needle == NULL, "string_replace_all_c", "argument needle cannot be NULL", NULL);
+    KLIB_CHECK(repl == NULL, "string_replace_all_c", "argument repl cannot be NULL", NULL);
+    KLIB_CHECK(needle[0] == '\0', "string_replace_all_c", "argument needle cannot be empty", NULL);
+    return replace_occurrences(str, needle, repl, (size_t)-1);
+};
+
+/*
+ * @brief    Replaces every non-overlapping occurence of the buffer of needle in str with the buffer of repl. 
+             Exits with code 1 if str, needle or repl are NULL. 
+             Exits with code 1 if needle is empty
+ * @param    str - the String in which the substrings are replaced
+ * @param    needle - the String to be replaced
+ * @param    repl - the String that needle is replaced with
+ * @returns  the parameter str
+ */
+String* string_replace_all(String* str, String* needle, String* repl) {
+    KLIB_CHECK(needle == NULL, "string_replace_all", "argument needle cannot be NULL", NULL);
+    KLIB_CHECK(repl == NULL, "string_replace_all", "argument repl cannot be NULL", NULL);
+    return string_replace_all_c(str, needle->buffer, repl->buffer);
+};
+
+// ##########################################################
+//                  Sorting Functions
+// ##########################################################
+
+/*
+ * @brief    Sorts an array of Strings in ascending byte order, using an MSD radix sort on the stored sizes. 
+             Strings are ordered as by string_compare, with shorter prefixes first. 
+             Exits with code 1 if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    strs - the Strings to be sorted
+ * @param    count - the number of Strings in strs
+ * @returns  none
+ */
+void string_sort(String** strs, unsigned int count) {
+    KLIB_CHECK_VOID(strs == NULL && count > 0, "string_sort", "argument strs cannot be NULL");
+    for(unsigned int i=0; i<count; i++)
+        KLIB_CHECK_VOID(strs[i] == NULL, "string_sort", "elements of strs cannot be NULL");
+    if(count < STRING_SORT_CUTOFF) {
+        insertion_sort_from(strs, count, 0);
+        return;
+    }
+    String** temp = (String**)malloc(count*sizeof(String*));
+    uint16_t* keys = (uint16_t*)malloc(count*sizeof(uint16_t));
+    radix_sort_from(strs, temp, keys, count, 0);
+    free(temp);
+    free(keys);
+};
+
+/*
+ * @brief    Sorts an array of Strings in ascending byte order, using threads to sort independent buckets. 
+             The input is split by its leading characters until no bucket holds more than a fraction of the work, 
+             and the buckets are then sorted concurrently. Small inputs, and every input when KLIB_THREADS 
+             is not defined, are sorted on the calling thread. 
+             Exits with code 1 if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    strs - the Strings to be sorted
+ * @param    count - the number of Strings in strs
+ * @param    threads - the number of threads to use, or 0 to use one per online processor
+ * @returns  none
+ */
+void string_sort_parallel(String** strs, unsigned int count, unsigned int threads) {
+    KLIB_CHECK_VOID(strs == NULL && count > 0, "string_sort_parallel", "argument strs cannot be NULL");
+    for(unsigned int i=0; i<count; i++)
+        KLIB_CHECK_VOID(strs[i] == NULL, "string_sort_parallel", "elements of strs cannot be NULL");
+    threads = resolve_threads(threads);
+    if(threads == 1 || count < STRING_SORT_PARALLEL_MIN) {
+        string_sort(strs, count);
+        return;
+    }
+
+    String** temp = (String**)malloc(count*sizeof(String*));
+    uint16_t* keys = (uint16_t*)malloc(count*sizeof(uint16_t));
+    size_t capacity = 256;
+    size_t taskCount = 1;
+    StringSortTask* tasks = (StringSortTask*)malloc(capacity*sizeof(StringSortTask));
+    tasks[0].offset = 0;
+    tasks[0].n = count;
+    tasks[0].depth = 0;
+
+    // Keep splitting the largest task until the work can be spread evenly over the threads
+    size_t limit = count / (threads*4);
+    size_t starts[258];
+    for(;;) {
+        size_t largest = 0;
+        for(size_t t=1; t<taskCount; t++) {
+            if(tasks[t].n > tasks[largest].n)
+                largest = t;
+        }
+        if(taskCount == 0 || tasks[largest].n <= limit)
+            break;
+        StringSortTask task = tasks[largest];
+        tasks[largest] = tasks[--taskCount];
+        radix_partition(strs + task.offset, temp + task.offset, keys + task.offset, task.n, task.depth, starts);
+        for(int b=1; b<257; b++) {
+            size_t size = starts[b+1]-starts[b];
+            if(size < 2)
+                continue;
+            if(taskCount == capacity) {
+                capacity *= 2;
+                tasks = (StringSortTask*)realloc(tasks, capacity*sizeof(StringSortTask));
+            }
+            tasks[taskCount].offset = task.offset + starts[b];
+            tasks[taskCount].n = size;
+            tasks[taskCount].depth = task.depth+1;
+            taskCount++;
+        }
+    }
+
+    StringSortJob job;
+    job.strs = strs;
+    job.temp = temp;
+    job.keys = keys;
+    job.tasks = tasks;
+    job.taskCount = taskCount;
+    job.next = 0;
+    run_workers(radix_sort_worker, &job, threads);
+
+    free(tasks);
+    free(temp);
+    free(keys);
+};
+
+/*
+ * @brief    Removes adjacent duplicates from an array of Strings, keeping the first String of each run. 
+             Run it after string_sort to remove every duplicate. The removed Strings are freed, and the 
+             remaining Strings are moved to the front of strs in their original order. 
+             Exits with code 1 if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    strs - the sorted Strings to be deduplicated
+ * @param    count - the number of Strings in strs
+ * @returns  The number of Strings left in strs
+ */
+unsigned int string_dedup(String** strs, unsigned int count) {
+    KLIB_CHECK(strs == NULL && count > 0, "string_dedup", "argument strs cannot be NULL", 0);
+    for(unsigned int i=0; i<count; i++)
+        KLIB_CHECK(strs[i] == NULL, "string_dedup", "elements of strs cannot be NULL", count);
+    if(count == 0)
+        return 0;
+    unsigned int kept = 1;
+    for(unsigned int i=1; i<count; i++) {
+        String* last = strs[kept-1];
+        if(strs[i]->size == last->size && memcmp(strs[i]->buffer, last->buffer, last->size) == 0)
+            free_string(strs[i]);
+        else
+            strs[kept++] = strs[i];
+    }
+    return kept;
+};
+
+// ##########################################################
+//                  Distance Functions
+// ##########################################################
+
+/*
+ * @brief    Computes the Levenshtein distance between str1 and str2 with a bit-parallel algorithm, in O(n*m/64) time. 
+             The shorter String is used as the pattern, in blocks of 64 characters. 
+             Exits with code 1 if either str1 or str2 are NULL
+ * @param    str1 - the first String to be compared
+ * @param    str2 - the second String to be compared
+ * @param    max - the largest distance of interest. Pass (size_t)-1 for no limit
+ * @returns  The edit distance between str1 and str2, or max+1 if the distance is greater than max
+ */
+size_t string_edit_distance(String* str1, String* str2, size_t max) {
+    KLIB_CHECK(str1 == NULL, "string_edit_distance", "argument str1 cannot be NULL", 0);
+    KLIB_CHECK(str2 == NULL, "string_edit_distance", "argument str2 cannot be NULL", 0);
+    if(str1->size > str2->size) {
+        String* temp = str1;
+        str1 = str2;
+        str2 = temp;
+    }
+    if(str1->size == 0)
+        return str2->size <= max ? str2->size : max+1;
+    uint64_t* peq = edit_pattern(str1->buffer, str1->size);
+    size_t d = edit_distance_bitparallel(peq, str1->size, str2->buffer, str2->size, max);
+    free(peq);
+    return d;
+};
+
+/*
+ * @brief    Computes the Levenshtein distance between query and each of count Strings. 
+             The pattern tables for query are built once and shared by every comparison and thread. 
+             Exits with code 1 if query or distances are NULL, if strs is NULL and count > 0, or if any of the Strings are NULL
+ * @param    query - the String to be matched
+ * @param    strs - the Strings query is compared against
+ * @param    count - the number of Strings in strs
+ * @param    max - the largest distance of interest. Pass (size_t)-1 for no limit
+ * @param    distances - receives count distances. Distances greater than max are stored as max+1
+ * @param    threads - the number of threads to use, 0 to use one per online processor, or 1 to run on the calling thread. 
+                       Ignored unless KLIB_THREADS is defined
+ * @returns  The index of the first String with the smallest distance, or count if no String is within max
+ */
+unsigned int string_edit_distance_batch(String* query, String** strs, unsigned int count, size_t max, size_t* distances, unsigned int threads) {
+    KLIB_CHECK(query == NULL, "string_edit_distance_batch", "argument query cannot be NULL", count);
+    KLIB_CHECK(strs == NULL && count > 0, "string_edit_distance_batch", "argument strs cannot be NULL", count);
+    KLIB_CHECK(distances == NULL && count > 0, "string_edit_distance_batch", "argument distances cannot be NULL", count);
+    for(unsigned int i=0; i<count; i++)
+        KLIB_CHECK(strs[i] == NULL, "string_edit_distance_batch", "elements of strs cannot be NULL", count);
+    threads = resolve_threads(threads);
+    if(threads > 1 && count <= EDIT_DISTANCE_BATCH_CHUNK)
+        threads = 1;
+
+    EditDistanceJob job;
+    job.peq = query->size > 0 ? edit_pattern(query->buffer, query->size) : NULL;
+    job.m = query->size;
+    job.strs = strs;
+    job.count = count;
+    job.max = max;
+    job.distances = distances;
+    job.next = 0;
+    run_workers(edit_distance_worker, &job, threads);
+    free((void*)job.peq);
+
+    unsigned int best = count;
+    for(unsigned int i=0; i<count; i++) {
+        if(distances[i] <= max && (best == count || distances[i] < distances[best]))
+            best = i;
+    }
+    return best;
+};
+
+// ##########################################################
+//                  Encoding Functions
+// ##########################################################
+
+/*
+ * @brief    Appends the lowercase hex encoding of the size bytes of src to dest. 
+             The buffer of src is treated as binary data, so it may contain NUL bytes. 
+             dest is resized once and the digits are written directly into its buffer. 
+             Exits with code 1 if either dest or src are NULL
+ * @param    dest - the destination String that has its buffer appended to
+ * @param    src - the source String holding the bytes to be encoded
+ * @returns  none
+ */
+void string_append_hex(String* dest, String* src) {
+    KLIB_CHECK_VOID(dest == NULL, "string_append_hex", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_append_hex", "argument src cannot be NULL");
+    size_t n = src->size;
+    string_reserve(dest, (dest->size + 2*n)*sizeof(char)+1);
+    hex_encode((const unsigned char*)src->buffer, n, dest->buffer + dest->size);
+    dest->size += 2*n;
+    dest->buffer[dest->size] = '\0';
+};
+
+/*
+ * @brief    Decodes the hex digits in the buffer of src and appends the resulting bytes to dest. 
+             Both upper and lower case digits are accepted. The decoded bytes may include NUL bytes, so use 
+             the size of dest rather than strlen. dest is resized once and the bytes are written directly into its buffer. 
+             Exits with code 1 if either dest or src are NULL
+ * @param    dest - the destination String that has its buffer appended to
+ * @param    src - the source String holding the hex digits
+ * @returns  1 on success, 0 if src has an odd size or contains a character that is not a hex digit. dest is unchanged on failure
+ */
+int string_append_from_hex(String* dest, String* src) {
+    KLIB_CHECK(dest == NULL, "string_append_from_hex", "argument dest cannot be NULL", 0);
+    KLIB_CHECK(src == NULL, "string_append_from_hex", "argument src cannot be NULL", 0);
+    size_t n = src->size;
+    if(n % 2 != 0)
+        return 0;
+    string_reserve(dest, (dest->size + n/2)*sizeof(char)+1);
+    if(!hex_decode(src->buffer, n, (unsigned char*)dest->buffer + dest->size)) {
+        dest->buffer[dest->size] = '\0';
+        return 0;
+    }
+    dest->size += n/2;
+    dest->buffer[dest->size] = '\0';
+    return 1;
+};
+
+/*
+ * @brief    Appends the base64 encoding (standard alphabet, '=' padded) of the size bytes of src to dest. 
+             The buffer of src is treated as binary data, so it may contain NUL bytes. 
+             dest is resized once and the characters are written directly into its buffer. 
+             Exits with code 1 if either dest or src are NULL
+ * @param    dest - the destination String that has its buffer appended to
+ * @param    src - the source String holding the bytes to be encoded
+ * @returns  none
+ */
+void string_append_base64(String* dest, String* src) {
+    KLIB_CHECK_VOID(dest == NULL, "string_append_base64", "argument dest cannot be NULL");
+    KLIB_CHECK_VOID(src == NULL, "string_append_base64", "argument src cannot be NULL");
+    size_t n = src->size;
+    size_t encoded = (n + 2) / 3 * 4;
+    string_reserve(dest, (dest->size + encoded)*sizeof(char)+1);
+    base64_encode((const unsigned char*)src->buffer, n, dest->buffer + dest->size);
+    dest->size += encoded;
+    dest->buffer[dest->size] = '\0';
+};
+
+/*
+ * @brief    Decodes the base64 (standard alphabet, '=' padded) buffer of src and appends the resulting bytes to dest. 
+             The decoded bytes may include NUL bytes, so use the size of dest rather than strlen. 
+             dest is resized once and the bytes are written directly into its buffer. 
+             Exits with code 1 if either dest or src are NULL
+ * @param    dest - the destination String that has its buffer appended to
+ * @param    src - the source String holding the base64 text
+ * @returns  1 on success, 0 if src is not valid padded base64. dest is unchanged on failure
+ */
+int string_append_from_base64(String* dest, String* src) {
+    KLIB_CHECK(dest == NULL, "string_append_from_base64", "argument dest cannot be NULL", 0);
+    KLIB_CHECK(src == NULL, "string_append_from_base64", "argument src cannot be NULL", 0);
+    size_t n = src->size;
+    if(n % 4 != 0)
+        return 0;
+    size_t decoded = n / 4 * 3;
+    if(n > 0 && src->buffer[n-1] == '=')
+        decoded -= (src->buffer[n-2] == '=') ? 2 : 1;
+    string_reserve(dest, (dest->size + decoded)*sizeof(char)+1);
+    if(!base64_decode(src->buffer, n, (unsigned char*)dest->buffer + dest->size)) {
+        dest->buffer[dest->size] = '\0';
+        return 0;
+    }
+    dest->size += decoded;
+    dest->buffer[dest->size] = '\0';
+    return 1;
+};